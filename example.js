@@ -1,3 +1,4 @@
+const child_process = require('child_process');
 const fs = require('fs');
 const path = require('path');
 const util = require('util');
@@ -17,6 +18,42 @@ async function names() {
     console.log(result);
 }
 
+async function enumerateStream(mode) {
+    // Compare time-to-first-item and peak memory of enumerate and enumerateStream on
+    // this host. test/run.js bench does the same on a large synthetic service set.
+    if (!mode) {
+        // Each mode runs in its own process, so that it gets its own peak RSS
+        for (const m of ['oneshot', 'stream']) {
+            child_process.execFileSync(process.execPath, [__filename, 'enumerate-stream', m], {stdio: 'inherit'});
+        }
+        return;
+    }
+    const baselineRss = process.resourceUsage().maxRSS;
+    let peakExternal = process.memoryUsage().external;
+    const sample = () => { peakExternal = Math.max(peakExternal, process.memoryUsage().external); };
+    const start = process.hrtime.bigint();
+    let first, count = 0;
+    const onItem = () => {
+        if (count++ === 0) first = process.hrtime.bigint();
+        if (count % 100 === 0) sample();
+    };
+    if (mode === 'oneshot') {
+        for (const name in service.enumerate()) onItem();
+    } else {
+        for await (const svc of service.enumerateStream()) onItem();
+    }
+    sample();
+    const end = process.hrtime.bigint();
+    console.log(mode, {
+        count,
+        firstMs: first === undefined ? null : Number(first - start) / 1e6,
+        totalMs: Number(end - start) / 1e6,
+        baselineRssKiB: baselineRss,
+        peakRssKiB: process.resourceUsage().maxRSS,
+        peakExternalKiB: Math.round(peakExternal / 1024),
+    });
+}
+
 async function create () {
     service.create(name, {
         displayName,
@@ -53,6 +90,10 @@ async function stop() {
     await service.stop(name);
 }
 
+async function stopWithin() {
+    console.log(await service.stopWithin(name, 5000));
+}
+
 async function restart() {
     console.log(service.status(name).state);
     await service.stop(name);
@@ -95,6 +136,8 @@ async function main() {
         return await enumerate();
     case 'names':
         return await names();
+    case 'enumerate-stream':
+        return await enumerateStream(args[1]);
     case 'create':
         return await create();
     case 'remove':
@@ -105,6 +148,8 @@ async function main() {
         return await start();
     case 'stop':
         return await stop();
+    case 'stop-within':
+        return await stopWithin();
     case 'restart':
         return await restart();
     case 'enable':
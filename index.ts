@@ -162,6 +162,68 @@ export function enumerate(typeFilter: TypeFilter|TypeFilter[] = TypeFilter.ALL,
     return _service.enumerate(typeFilter, stateFilter);
 }
 
+export interface StreamOptions {
+    /** Size in bytes of each page fetched from the service control manager (at most 256 KiB) */
+    pageSize?:         number;
+    /** Number of pages fetched ahead of the consumer */
+    maxBufferedPages?: number;
+}
+
+async function* streamPages<T>(typeFilter: TypeFilter|TypeFilter[], stateFilter: StateFilter,
+                               withStatus: boolean, options: StreamOptions): AsyncGenerator<T>
+{
+    assertWindows();
+    typeFilter = Array.isArray(typeFilter) ? bitmask(typeFilter) : typeFilter;
+    const pages = _service.enumeratePages(typeFilter, stateFilter, withStatus,
+                                          options.pageSize ?? 64 * 1024,
+                                          options.maxBufferedPages ?? 2);
+    try {
+        while (true) {
+            const page: T[]|undefined = await pages.next();
+            if (!page) {
+                return;
+            }
+            yield* page;
+        }
+    } finally {
+        pages.close();
+    }
+}
+
+/** Stream names of registered services
+ * 
+ * Services are fetched page by page on a background thread, so the first names are
+ * available before the whole list has been retrieved. Breaking out of the loop stops
+ * the enumeration.
+ * 
+ * @param type    Filter for service type (@see TypeFilter)
+ * @param state   Filter for service state (@see StateFilter)
+ * @param options Page size and read-ahead (@see StreamOptions)
+ */
+export function namesStream(typeFilter: TypeFilter|TypeFilter[] = TypeFilter.ALL,
+                            stateFilter: StateFilter = StateFilter.ALL,
+                            options: StreamOptions = {}): AsyncGenerator<string>
+{
+    return streamPages<string>(typeFilter, stateFilter, false, options);
+}
+
+/** Stream registered services
+ * 
+ * Like enumerate, but services are yielded one by one as their pages arrive
+ * (@see namesStream).
+ * 
+ * @param type    Filter for service type (@see TypeFilter)
+ * @param state   Filter for service state (@see StateFilter)
+ * @param options Page size and read-ahead (@see StreamOptions)
+ */
+export type EnumerateStreamResult = ServiceStatus & {name: string, displayName?: string};
+export function enumerateStream(typeFilter: TypeFilter|TypeFilter[] = TypeFilter.ALL,
+                                stateFilter: StateFilter = StateFilter.ALL,
+                                options: StreamOptions = {}): AsyncGenerator<EnumerateStreamResult>
+{
+    return streamPages<EnumerateStreamResult>(typeFilter, stateFilter, true, options);
+}
+
 /** Retrieve service configuration
  * @param name Name of service
  */
@@ -218,6 +280,57 @@ export function stop(name: string) {
     });
 }
 
+/** How a stop with a grace period ended */
+export enum StopPhase {
+    /** The service stopped by itself */
+    STOPPED = 'STOPPED',
+    /** The process was terminated before the grace period expired, because the checkpoint did not advance within the wait hint */
+    STALLED = 'STALLED',
+    /** The process was terminated because the grace period expired */
+    TIMEOUT = 'TIMEOUT',
+}
+
+export interface StopResult {
+    phase:   StopPhase;
+    /** Milliseconds until the service reached STOPPED */
+    elapsed: number;
+}
+
+/** Stop service, terminating its process tree if it does not stop in time
+ * 
+ * The grace period starts before the stop control is sent, so it also covers a control
+ * handler that hangs. It is an upper bound, not a guaranteed wait: a service that reports
+ * a wait hint is terminated as soon as its checkpoint does not advance within that hint,
+ * even if the grace period has not expired yet. A service reporting no wait hint gets
+ * the whole grace period. If the process cannot be terminated, or the service does not
+ * reach STOPPED within 10 seconds after that, the promise is rejected.
+ * 
+ * The promise is rejected without terminating anything if the service cannot be stopped
+ * (e.g. it is START_PENDING), if it accepts the stop and then leaves STOP_PENDING for any
+ * state other than STOPPED (e.g. it is RUNNING again), or if it shares its process with
+ * other services.
+ * 
+ * @param name        Name of service
+ * @param gracePeriod Maximum time in milliseconds the service is given to stop by itself
+ *                    (0 to 2147483647)
+ */
+export function stopWithin(name: string, gracePeriod: number): Promise<StopResult> {
+    return new Promise<StopResult>((resolve, reject) => {
+        try {
+            assertWindows();
+            _service.stopWithin(name, gracePeriod, (err?: Error, result?: StopResult) => {
+                if (err) {
+                    reject(err);
+                } else {
+                    resolve(result!);
+                }
+            })
+        } catch (err) {
+            reject(err);
+        }
+    });
+}
+
 /** Enable service
  * @param name Name of service to enable
  * @param startType Desired start type for service
@@ -0,0 +1,62 @@
+#include <windows.h>
+#include <string>
+#include <vector>
+
+struct ServiceEntry {
+    std::wstring           name;
+    std::wstring           display_name;
+    SERVICE_STATUS_PROCESS status;
+};
+using ServicePage = std::vector<ServiceEntry>;
+
+// Retrieves all services matching type and state at once, growing buffer until the
+// whole list fits. On failure returns false and leaves the error in GetLastError.
+inline bool enum_services(SC_HANDLE manager, DWORD type, DWORD state, std::vector<char>& buffer, DWORD& n_services) {
+    DWORD size = 0;
+    while (!EnumServicesStatusExW(manager, SC_ENUM_PROCESS_INFO, type, state,
+                                  buffer.empty() ? nullptr : (LPBYTE)buffer.data(),
+                                  buffer.size(), &size, &n_services, nullptr, nullptr)) {
+        if (GetLastError() == ERROR_MORE_DATA)
+            buffer.resize(size);
+        else
+            return false;
+    }
+    return true;
+}
+
+// Retrieves services matching type and state in pages of page_size bytes using the
+// resume handle, and calls on_page with each page until it returns false. On failure
+// returns false and leaves the error in GetLastError.
+template<typename OnPage>
+inline bool enum_service_pages(SC_HANDLE manager, DWORD type, DWORD state, DWORD page_size, OnPage on_page) {
+    std::vector<char> buffer(page_size);
+    DWORD resume_handle = 0;
+    bool more = true;
+    while (more) {
+        DWORD size = 0, n_services = 0;
+        more = !EnumServicesStatusExW(manager, SC_ENUM_PROCESS_INFO, type, state,
+                                      (LPBYTE)buffer.data(), buffer.size(), &size, &n_services,
+                                      &resume_handle, nullptr);
+        if (more && GetLastError() != ERROR_MORE_DATA)
+            return false;
+        if (more && n_services == 0) {
+            // Page size too small for even a single entry
+            buffer.resize(buffer.size() * 2);
+            continue;
+        }
+
+        LPENUM_SERVICE_STATUS_PROCESSW services = (LPENUM_SERVICE_STATUS_PROCESSW) buffer.data();
+        ServicePage page;
+        page.reserve(n_services);
+        for (DWORD i=0; i<n_services; ++i) {
+            page.push_back({
+                services[i].lpServiceName,
+                services[i].lpDisplayName ? services[i].lpDisplayName : L"",
+                services[i].ServiceStatusProcess,
+            });
+        }
+        if (!on_page(std::move(page)))
+            break;
+    }
+    return true;
+}
@@ -7,11 +7,13 @@ Napi::Object init(Napi::Env env, Napi::Object exports) {
     exports["names"]     = Napi::Function::New(env, sc_names);
 
     exports["enumerate"] = Napi::Function::New(env, sc_enumerate);
+    exports["enumeratePages"] = Napi::Function::New(env, sc_enumerate_pages);
     exports["config"]    = Napi::Function::New(env, sc_config);
     exports["status"]    = Napi::Function::New(env, sc_status);
 
     exports["start"]     = Napi::Function::New(env, sc_start);
     exports["stop"]      = Napi::Function::New(env, sc_stop);
+    exports["stopWithin"] = Napi::Function::New(env, sc_stop_within);
 
     exports["create" ]   = Napi::Function::New(env, sc_create);
     exports["change"]    = Napi::Function::New(env, sc_change);
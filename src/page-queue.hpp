@@ -0,0 +1,89 @@
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <string>
+
+// Bounded queue of pages between a producer thread and a consumer, independent of
+// Win32 and N-API so that it can be tested on its own.
+//
+// The producer blocks once max_pages pages are buffered. Closing the queue drops the
+// buffered pages and makes the producer stop at its next push.
+template<typename Page>
+class PageQueue {
+    public:
+        enum class Take {
+            PAGE,  // page was taken
+            EMPTY, // no page buffered yet
+            END,   // producer finished (error tells whether it failed) or queue closed
+        };
+
+        explicit PageQueue(size_t max_pages) : max_pages_(max_pages) {}
+
+        // Producer: waits for room in the queue. Returns false once closed.
+        bool push(Page page) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return closed_ || pages_.size() < max_pages_; });
+            if (closed_)
+                return false;
+            pages_.push_back(std::move(page));
+            cv_.notify_all();
+            return true;
+        }
+
+        // Producer: no more pages will follow, error is empty on success
+        void finish(const std::string& error) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            done_ = true;
+            error_ = error;
+            cv_.notify_all();
+        }
+
+        // Consumer: stops the producer, may be called from any thread
+        void close() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            closed_ = true;
+            pages_.clear();
+            cv_.notify_all();
+        }
+
+        // Consumer: takes a page without waiting
+        Take try_take(Page& page, std::string& error) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return take_locked(page, error);
+        }
+
+        // Consumer: waits until a page or the end is available
+        Take take(Page& page, std::string& error) {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cv_.wait(lock, [this] { return closed_ || done_ || !pages_.empty(); });
+            return take_locked(page, error);
+        }
+
+        size_t size() {
+            std::lock_guard<std::mutex> lock(mutex_);
+            return pages_.size();
+        }
+
+    private:
+        Take take_locked(Page& page, std::string& error) {
+            if (!pages_.empty()) {
+                page = std::move(pages_.front());
+                pages_.pop_front();
+                cv_.notify_all();
+                return Take::PAGE;
+            } else if (done_ || closed_) {
+                error = error_;
+                return Take::END;
+            } else {
+                return Take::EMPTY;
+            }
+        }
+
+        const size_t            max_pages_;
+        std::mutex              mutex_;
+        std::condition_variable cv_;
+        std::deque<Page>        pages_;
+        bool                    done_ = false;
+        bool                    closed_ = false;
+        std::string             error_;
+};
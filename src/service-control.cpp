@@ -1,6 +1,15 @@
 #include "service-control.hpp"
 #include "utils.hpp"
+#include "enum-services.hpp"
+#include "page-queue.hpp"
+#include "stop-policy.hpp"
+#include <tlhelp32.h>
+#include <algorithm>
+#include <cmath>
+#include <iterator>
+#include <mutex>
 #include <sstream>
+#include <thread>
 #include <iostream>
 
 namespace {
@@ -44,6 +53,364 @@ namespace {
             DWORD initial_state_;
             DWORD target_state_;
     };
+
+    // Pages of services fetched by a background thread using the resume handle of
+    // EnumServicesStatusEx, buffered in a PageQueue until JS consumes them. Pages are
+    // handed out on the JS thread only.
+    class PageStream : public std::enable_shared_from_this<PageStream> {
+        public:
+            PageStream(const Napi::Env& env, bool with_status, size_t max_pages)
+            : with_status_(with_status), queue_(max_pages)
+            {
+                tsfn_ = Napi::ThreadSafeFunction::New(env, Napi::Function::New(env, [](const Napi::CallbackInfo&) {}),
+                                                      "win32-service:enumerate", 0, 1);
+                tsfn_.Unref(env);
+            }
+
+            void start(DWORD type, DWORD state, DWORD page_size) {
+                auto self = shared_from_this();
+                std::thread([self, type, state, page_size] {
+                    self->finish(self->fetch(type, state, page_size));
+                }).detach();
+            }
+
+            // Called from JS: returns a promise for the next page, or undefined at the end
+            Napi::Value next(const Napi::Env& env) {
+                if (pending_)
+                    throw Napi::Error::New(env, "Previous page has not been delivered yet");
+                pending_.reset(new Napi::Promise::Deferred(env));
+                auto promise = pending_->Promise();
+                if (!settle(env))
+                    tsfn_.Ref(env);
+                return promise;
+            }
+
+            // Called from JS when the consumer stops early
+            void close(const Napi::Env& env) {
+                queue_.close();
+                if (pending_) {
+                    pending_->Resolve(env.Undefined());
+                    pending_.reset();
+                    tsfn_.Unref(env);
+                }
+            }
+
+            // Stops the background thread, may be called from any thread
+            void close() {
+                queue_.close();
+            }
+
+        private:
+            std::string fetch(DWORD type, DWORD state, DWORD page_size) {
+                auto manager = SC_HANDLE_ptr(OpenSCManagerW(nullptr, nullptr, SC_MANAGER_ENUMERATE_SERVICE));
+                if (!manager)
+                    return error_message("OpenSCManager");
+
+                if (!enum_service_pages(manager.get(), type, state, page_size,
+                                        [this](ServicePage page) { return push(std::move(page)); }))
+                    return error_message("EnumServicesStatusEx");
+                return std::string();
+            }
+
+            bool push(ServicePage page) {
+                if (!queue_.push(std::move(page)))
+                    return false;
+                deliver();
+                return true;
+            }
+
+            void finish(const std::string& error) {
+                queue_.finish(error);
+                deliver();
+                tsfn_.Release();
+            }
+
+            void deliver() {
+                auto self = shared_from_this();
+                tsfn_.NonBlockingCall([self](Napi::Env env, Napi::Function) {
+                    if (env != nullptr && self->pending_ && self->settle(env))
+                        self->tsfn_.Unref(env);
+                });
+            }
+
+            // Resolves or rejects the pending promise if a page or the end is available
+            bool settle(const Napi::Env& env) {
+                ServicePage page;
+                std::string error;
+                switch (queue_.try_take(page, error)) {
+                    case PageQueue<ServicePage>::Take::PAGE: {
+                        auto deferred = std::move(pending_);
+                        deferred->Resolve(page_to_array(env, page));
+                        return true;
+                    }
+                    case PageQueue<ServicePage>::Take::END: {
+                        auto deferred = std::move(pending_);
+                        if (error.empty())
+                            deferred->Resolve(env.Undefined());
+                        else
+                            deferred->Reject(Napi::Error::New(env, error).Value());
+                        return true;
+                    }
+                    default:
+                        return false;
+                }
+            }
+
+            Napi::Array page_to_array(const Napi::Env& env, const ServicePage& page) {
+                auto result = Napi::Array::New(env, page.size());
+                for (uint32_t i=0; i<page.size(); ++i) {
+                    if (with_status_) {
+                        auto obj = status_to_object(env, page[i].status);
+                        obj.Set("name", Napi::String::New(env, converter.to_bytes(page[i].name)));
+                        if (!page[i].display_name.empty())
+                            obj.Set("displayName", Napi::String::New(env, converter.to_bytes(page[i].display_name)));
+                        result[i] = obj;
+                    } else {
+                        result[i] = converter.to_bytes(page[i].name);
+                    }
+                }
+                return result;
+            }
+
+            const bool               with_status_;
+            Napi::ThreadSafeFunction tsfn_;
+            PageQueue<ServicePage>   queue_;
+
+            // JS thread only
+            std::unique_ptr<Napi::Promise::Deferred> pending_;
+    };
+
+    uint64_t creation_time(HANDLE process) {
+        FILETIME created, exited, kernel, user;
+        if (!GetProcessTimes(process, &created, &exited, &kernel, &user))
+            return 0;
+        return (uint64_t(created.dwHighDateTime) << 32) | created.dwLowDateTime;
+    }
+
+    class Win32StopProcess : public StopProcess {
+        public:
+            Win32StopProcess(DWORD pid, HANDLE_ptr process) : pid_(pid), process_(std::move(process)) {}
+
+            // Terminates the process and its descendants, children first. Toolhelp only
+            // records the PID of the parent, which may since have exited and had its PID
+            // reused, so a child is only accepted if it was created after its parent.
+            std::string terminate_tree() override {
+                struct TreeProcess {
+                    DWORD      pid;
+                    HANDLE_ptr handle;
+                    uint64_t   created;
+                };
+                const auto root_created = creation_time(process_.get());
+                if (!root_created)
+                    return error_message("GetProcessTimes");
+
+                std::vector<TreeProcess> tree;
+                auto snapshot = HANDLE_ptr(CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0));
+                if (snapshot.get() != INVALID_HANDLE_VALUE) {
+                    std::vector<std::pair<DWORD, DWORD>> parents;
+                    PROCESSENTRY32W entry;
+                    entry.dwSize = sizeof(entry);
+                    for (auto ok = Process32FirstW(snapshot.get(), &entry); ok; ok = Process32NextW(snapshot.get(), &entry))
+                        parents.emplace_back(entry.th32ParentProcessID, entry.th32ProcessID);
+
+                    auto known = [this, &tree](DWORD pid) {
+                        return pid == pid_ || std::any_of(tree.begin(), tree.end(),
+                                                          [pid](const TreeProcess& p) { return p.pid == pid; });
+                    };
+                    for (size_t i=0; i<=tree.size(); ++i) {
+                        const auto parent_pid = i ? tree[i-1].pid : pid_;
+                        const auto parent_created = i ? tree[i-1].created : root_created;
+                        for (const auto& p : parents) {
+                            if (p.first != parent_pid || known(p.second))
+                                continue;
+                            auto child = HANDLE_ptr(OpenProcess(PROCESS_TERMINATE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, p.second));
+                            if (!child)
+                                continue;
+                            const auto created = creation_time(child.get());
+                            if (created && created >= parent_created)
+                                tree.push_back({p.second, std::move(child), created});
+                        }
+                    }
+                }
+
+                for (auto it = tree.rbegin(); it != tree.rend(); ++it)
+                    TerminateProcess(it->handle.get(), ERROR_PROCESS_ABORTED);
+                if (!TerminateProcess(process_.get(), ERROR_PROCESS_ABORTED))
+                    return error_message("TerminateProcess");
+                return std::string();
+            }
+
+        private:
+            DWORD      pid_;
+            HANDLE_ptr process_;
+    };
+
+    class Win32StopSystem : public StopSystem {
+        public:
+            Win32StopSystem(SC_HANDLE_ptr manager, SC_HANDLE_ptr service)
+            : shared_(std::make_shared<Shared>())
+            {
+                shared_->manager = std::move(manager);
+                shared_->service = std::move(service);
+            }
+
+            uint32_t now() override {
+                return GetTickCount();
+            }
+
+            // ControlService waits for the control handler of the service, for about 30
+            // seconds if it hangs, so it gets a thread of its own
+            void send_stop() override {
+                auto shared = shared_;
+                std::thread([shared] {
+                    SERVICE_STATUS status;
+                    auto request = StopRequest::ACCEPTED;
+                    std::string error;
+                    if (!ControlService(shared->service.get(), SERVICE_CONTROL_STOP, &status)) {
+                        switch (::GetLastError()) {
+                            case ERROR_SERVICE_NOT_ACTIVE:         request = StopRequest::ACCEPTED;  break;
+                            case ERROR_SERVICE_REQUEST_TIMEOUT:    request = StopRequest::TIMED_OUT; break;
+                            case ERROR_SERVICE_CANNOT_ACCEPT_CTRL: request = StopRequest::REFUSED;   break;
+                            default:
+                                request = StopRequest::FAILED;
+                                error = error_message("ControlService");
+                        }
+                    }
+                    std::lock_guard<std::mutex> lock(shared->mutex);
+                    shared->request = request;
+                    shared->error = error;
+                }).detach();
+            }
+
+            StopRequest stop_request(std::string& error) override {
+                std::lock_guard<std::mutex> lock(shared_->mutex);
+                error = shared_->error;
+                return shared_->request;
+            }
+
+            std::string query(StopStatus& result) override {
+                SERVICE_STATUS_PROCESS status;
+                DWORD size = 0;
+                if (!QueryServiceStatusEx(shared_->service.get(), SC_STATUS_PROCESS_INFO, (LPBYTE)&status, sizeof(status), &size))
+                    return error_message("QueryServiceStatusEx");
+                result.state          = status.dwCurrentState;
+                result.state_name     = service_state(status.dwCurrentState);
+                result.check_point    = status.dwCheckPoint;
+                result.wait_hint      = status.dwWaitHint;
+                result.process_id     = status.dwProcessId;
+                result.shared_process = (status.dwServiceType & SERVICE_WIN32_SHARE_PROCESS) ||
+                                        (status.dwServiceFlags & SERVICE_RUNS_IN_SYSTEM_PROCESS);
+                return std::string();
+            }
+
+            std::unique_ptr<StopProcess> open(uint32_t pid, std::string& error) override {
+                auto process = HANDLE_ptr(OpenProcess(PROCESS_TERMINATE | PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid));
+                if (process)
+                    return std::unique_ptr<StopProcess>(new Win32StopProcess(pid, std::move(process)));
+                // ERROR_INVALID_PARAMETER means the process has already exited
+                if (GetLastError() != ERROR_INVALID_PARAMETER)
+                    error = error_message("OpenProcess");
+                return nullptr;
+            }
+
+        private:
+            // Shared with the thread sending the stop control, which may outlive the stop
+            struct Shared {
+                SC_HANDLE_ptr manager;
+                SC_HANDLE_ptr service;
+                std::mutex    mutex;
+                StopRequest   request = StopRequest::PENDING;
+                std::string   error;
+            };
+            std::shared_ptr<Shared> shared_;
+    };
+
+    struct MonitoredStop {
+        StopJob                  job;
+        Napi::ThreadSafeFunction callback;
+
+        void complete() {
+            const auto result = job.result();
+            callback.BlockingCall([result](Napi::Env env, Napi::Function js_callback) {
+                if (env == nullptr) {
+                    return;
+                } else if (!result.error.empty()) {
+                    js_callback.Call({Napi::Error::New(env, result.error).Value()});
+                } else {
+                    auto obj = Napi::Object::New(env);
+                    obj["phase"] = std::string(stop_phase(result.phase));
+                    obj["elapsed"] = static_cast<double>(result.elapsed);
+                    js_callback.Call({env.Undefined(), obj});
+                }
+            });
+            callback.Release();
+        }
+    };
+
+    // All stops with a grace period are polled by a single thread, which exits
+    // when no stops are left
+    class StopMonitor {
+        public:
+            static void add(std::unique_ptr<MonitoredStop> stop) {
+                auto& state = get_state();
+                std::lock_guard<std::mutex> lock(state.mutex);
+                state.stops.push_back(std::move(stop));
+                if (!state.running) {
+                    state.running = true;
+                    std::thread(&StopMonitor::run).detach();
+                }
+            }
+
+        private:
+            struct State {
+                std::mutex                                  mutex;
+                std::vector<std::unique_ptr<MonitoredStop>> stops;
+                bool                                        running = false;
+            };
+
+            // Never freed, so that the detached thread can still use it while static
+            // destructors run at process exit
+            static State& get_state() {
+                static auto* state = new State;
+                return *state;
+            }
+
+            static void run() {
+                auto& state = get_state();
+                while (true) {
+                    std::vector<std::unique_ptr<MonitoredStop>> stops;
+                    {
+                        std::lock_guard<std::mutex> lock(state.mutex);
+                        if (state.stops.empty()) {
+                            state.running = false;
+                            return;
+                        }
+                        stops.swap(state.stops);
+                    }
+                    stops.erase(std::remove_if(stops.begin(), stops.end(), [](const std::unique_ptr<MonitoredStop>& stop) {
+                                    if (!stop->job.poll())
+                                        return false;
+                                    stop->complete();
+                                    return true;
+                                }),
+                                stops.end());
+                    {
+                        std::lock_guard<std::mutex> lock(state.mutex);
+                        std::move(stops.begin(), stops.end(), std::back_inserter(state.stops));
+                    }
+                    Sleep(sleep_interval);
+                }
+            }
+
+            static const DWORD sleep_interval = 100;
+    };
+
+    // Owned by the JS functions returned from sc_enumerate_pages, stops the
+    // background thread once they are garbage collected
+    struct PageStreamHandle {
+        std::shared_ptr<PageStream> stream;
+        ~PageStreamHandle() { stream->close(); }
+    };
 }
 
 Napi::Object sc_names(Napi::CallbackInfo& info) {
@@ -54,15 +421,9 @@ Napi::Object sc_names(Napi::CallbackInfo& info) {
     const auto manager = get_manager(env, SC_MANAGER_ENUMERATE_SERVICE);
 
     std::vector<char> buffer;
-    DWORD size = 0, n_services = 0;
-    while (!EnumServicesStatusExW(manager.get(), SC_ENUM_PROCESS_INFO, type, state,
-                                  buffer.empty() ? nullptr : (LPBYTE)buffer.data(),
-                                  buffer.size(), &size, &n_services, nullptr, nullptr)) {
-        if (GetLastError() == ERROR_MORE_DATA)
-            buffer.resize(size);
-        else
-            throw Napi::Error::New(env, error_message("QueryServiceConfig"));
-    }
+    DWORD n_services = 0;
+    if (!enum_services(manager.get(), type, state, buffer, n_services))
+        throw Napi::Error::New(env, error_message("EnumServicesStatusEx"));
     LPENUM_SERVICE_STATUS_PROCESSW services = (LPENUM_SERVICE_STATUS_PROCESSW) buffer.data();
 
     auto result = Napi::Array::New(env);
@@ -79,15 +440,9 @@ Napi::Object sc_enumerate(Napi::CallbackInfo& info) {
     const auto manager = get_manager(env, SC_MANAGER_ENUMERATE_SERVICE);
 
     std::vector<char> buffer;
-    DWORD size = 0, n_services = 0;
-    while (!EnumServicesStatusExW(manager.get(), SC_ENUM_PROCESS_INFO, type, state,
-                                  buffer.empty() ? nullptr : (LPBYTE)buffer.data(),
-                                  buffer.size(), &size, &n_services, nullptr, nullptr)) {
-        if (GetLastError() == ERROR_MORE_DATA)
-            buffer.resize(size);
-        else
-            throw Napi::Error::New(env, error_message("QueryServiceConfig"));
-    }
+    DWORD n_services = 0;
+    if (!enum_services(manager.get(), type, state, buffer, n_services))
+        throw Napi::Error::New(env, error_message("EnumServicesStatusEx"));
     LPENUM_SERVICE_STATUS_PROCESSW services = (LPENUM_SERVICE_STATUS_PROCESSW) buffer.data();
 
     auto result = Napi::Object::New(env);
@@ -101,6 +456,32 @@ Napi::Object sc_enumerate(Napi::CallbackInfo& info) {
     return result;
 }
 
+Napi::Object sc_enumerate_pages(Napi::CallbackInfo& info) {
+    const auto env = info.Env();
+    const auto type = info[0].As<Napi::Number>().Uint32Value();
+    const auto state = info[1].As<Napi::Number>().Uint32Value();
+    const auto with_status = info[2].As<Napi::Boolean>().Value();
+    const auto page_size = info[3].As<Napi::Number>().Uint32Value();
+    const auto max_pages = info[4].As<Napi::Number>().Uint32Value();
+    if (page_size == 0 || page_size > 256 * 1024)
+        throw Napi::RangeError::New(env, "Page size must be between 1 and 262144 bytes");
+    if (max_pages == 0)
+        throw Napi::RangeError::New(env, "At least one page must be buffered");
+
+    auto handle = std::make_shared<PageStreamHandle>();
+    handle->stream = std::make_shared<PageStream>(env, with_status, max_pages);
+    handle->stream->start(type, state, page_size);
+
+    auto result = Napi::Object::New(env);
+    result["next"] = Napi::Function::New(env, [handle](const Napi::CallbackInfo& info) {
+        return handle->stream->next(info.Env());
+    });
+    result["close"] = Napi::Function::New(env, [handle](const Napi::CallbackInfo& info) {
+        handle->stream->close(info.Env());
+    });
+    return result;
+}
+
 Napi::Object sc_config(Napi::CallbackInfo& info) {
     std::vector<char> buffer;
     const auto env = info.Env();
@@ -179,6 +560,30 @@ void sc_stop(Napi::CallbackInfo& info) {
         (new StatusWaitWorker(name, SERVICE_STOP_PENDING, SERVICE_STOPPED, info[1].As<Napi::Function>()))->Queue();
 }
 
+void sc_stop_within(Napi::CallbackInfo& info) {
+    const auto env = info.Env();
+    const auto name = get_name(env, info[0]);
+    if (!info[1].IsNumber())
+        throw Napi::TypeError::New(env, "Expected grace period as second argument");
+    const auto grace_period = info[1].As<Napi::Number>().DoubleValue();
+    if (!std::isfinite(grace_period) || grace_period < 0 || grace_period > 0x7fffffff)
+        throw Napi::RangeError::New(env, "Grace period must be between 0 and 2147483647 milliseconds");
+    if (!info[2].IsFunction())
+        throw Napi::TypeError::New(env, "Expected callback as third argument");
+
+    auto manager = get_manager(env, GENERIC_READ);
+    auto service = get_service(env, manager.get(), name.c_str(), SERVICE_STOP | SERVICE_QUERY_STATUS);
+    auto callback = Napi::ThreadSafeFunction::New(env, info[2].As<Napi::Function>(), "win32-service:stop", 0, 1);
+
+    // The grace period starts here, the stop control is sent off the JS thread
+    std::unique_ptr<MonitoredStop> stop(new MonitoredStop{
+        StopJob(info[0].As<Napi::String>().Utf8Value(), static_cast<uint32_t>(grace_period),
+                std::unique_ptr<StopSystem>(new Win32StopSystem(std::move(manager), std::move(service)))),
+        callback,
+    });
+    StopMonitor::add(std::move(stop));
+}
+
 void sc_change(Napi::CallbackInfo& info) {
     const auto env = info.Env();
     const auto name = get_name(env, info[0]);
@@ -0,0 +1,255 @@
+#include <cstdint>
+#include <memory>
+#include <sstream>
+#include <string>
+
+// Stop with a grace period, independent of Win32 so that it can be tested against
+// a simulated service control manager.
+//
+// The grace period starts before the stop control is sent, and is an upper bound on
+// how long the service may take to stop by itself, including a control handler that
+// does not answer. If the service reports a wait hint and its checkpoint does not advance
+// within that hint, it has stalled and is terminated before the grace period ends.
+// Services reporting no wait hint are only subject to the grace period.
+
+// Values of SERVICE_STATUS::dwCurrentState the policy cares about
+const uint32_t STOP_STATE_STOPPED      = 1;
+const uint32_t STOP_STATE_STOP_PENDING = 3;
+const uint32_t STOP_STATE_RUNNING      = 4;
+
+struct StopStatus {
+    uint32_t    state;
+    const char* state_name;
+    uint32_t    check_point;
+    uint32_t    wait_hint;
+    uint32_t    process_id;
+    bool        shared_process;
+};
+
+// Times in milliseconds, wrapping like GetTickCount
+struct StopProgress {
+    uint32_t started;
+    uint32_t last_progress;
+    uint32_t last_check_point;
+};
+
+// Outcome of sending the stop control
+enum class StopRequest {
+    PENDING,   // not answered yet
+    ACCEPTED,  // accepted, or the service was not active
+    TIMED_OUT, // the control handler did not answer (ERROR_SERVICE_REQUEST_TIMEOUT)
+    REFUSED,   // the service cannot accept controls in its state (ERROR_SERVICE_CANNOT_ACCEPT_CTRL)
+    FAILED,    // any other error
+};
+
+enum class StopPhase {
+    PENDING,  // keep waiting
+    STOPPED,  // stopped by itself
+    CHANGED,  // not stopping, e.g. rejected the stop and is RUNNING again
+    STALLED,  // checkpoint did not advance within the wait hint
+    TIMEOUT,  // grace period expired
+};
+
+inline const char* stop_phase(StopPhase phase) {
+    switch (phase) {
+        case StopPhase::PENDING: return "PENDING";
+        case StopPhase::STOPPED: return "STOPPED";
+        case StopPhase::CHANGED: return "CHANGED";
+        case StopPhase::STALLED: return "STALLED";
+        case StopPhase::TIMEOUT: return "TIMEOUT";
+        default:                 return "UNKNOWN";
+    }
+}
+
+inline StopProgress stop_progress(const StopProgress& progress, const StopStatus& status, uint32_t now) {
+    if (status.check_point == progress.last_check_point)
+        return progress;
+    return {progress.started, now, status.check_point};
+}
+
+inline StopPhase stop_decision(const StopStatus& status, StopRequest request, const StopProgress& progress,
+                               uint32_t now, uint32_t grace_period) {
+    if (status.state == STOP_STATE_STOPPED)
+        return StopPhase::STOPPED;
+    if (status.state != STOP_STATE_STOP_PENDING) {
+        // A service whose control handler hangs stays RUNNING
+        if (request == StopRequest::ACCEPTED || request == StopRequest::REFUSED)
+            return StopPhase::CHANGED;
+        if (request == StopRequest::PENDING && status.state != STOP_STATE_RUNNING)
+            return StopPhase::PENDING;
+    }
+    if (now - progress.started >= grace_period)
+        return StopPhase::TIMEOUT;
+    if (status.wait_hint && now - progress.last_progress > status.wait_hint)
+        return StopPhase::STALLED;
+    return StopPhase::PENDING;
+}
+
+// A process opened for termination. Keeping it open prevents its PID from being reused.
+class StopProcess {
+    public:
+        virtual ~StopProcess() {}
+        // Terminates the process and its descendants. Returns an error message on failure.
+        virtual std::string terminate_tree() = 0;
+};
+
+// Everything a stop needs from the system
+class StopSystem {
+    public:
+        virtual ~StopSystem() {}
+        virtual uint32_t now() = 0;
+        // Sends the stop control without blocking the caller
+        virtual void send_stop() = 0;
+        // Sets error if the outcome is FAILED
+        virtual StopRequest stop_request(std::string& error) = 0;
+        // Returns an error message on failure
+        virtual std::string query(StopStatus& status) = 0;
+        // Returns nullptr without an error if the process has already exited
+        virtual std::unique_ptr<StopProcess> open(uint32_t pid, std::string& error) = 0;
+};
+
+struct StopResult {
+    std::string error;
+    StopPhase   phase;
+    uint32_t    elapsed;
+};
+
+class StopJob {
+    public:
+        StopJob(const std::string& name, uint32_t grace_period, std::unique_ptr<StopSystem> system)
+        : name_(name), grace_period_(grace_period), system_(std::move(system))
+        {
+            const auto now = system_->now();
+            progress_ = {now, now, 0};
+            system_->send_stop();
+        }
+
+        // Returns true once the stop has ended, result() then tells how
+        inline bool poll();
+        const StopResult& result() const { return result_; }
+
+        static const uint32_t termination_timeout = 10 * 1000;
+
+    private:
+        inline bool poll_terminated(const StopStatus& status, uint32_t now);
+        inline bool finish(StopPhase phase, const std::string& error = std::string());
+
+        std::string                 name_;
+        uint32_t                    grace_period_;
+        std::unique_ptr<StopSystem> system_;
+        StopProgress                progress_;
+        bool                        escalating_ = false;
+        uint32_t                    escalated_at_ = 0;
+        StopPhase                   terminated_by_ = StopPhase::PENDING;
+        uint32_t                    terminated_at_ = 0;
+        uint32_t                    terminated_state_ = 0;
+        StopResult                  result_;
+};
+
+// Implementation
+
+bool StopJob::poll() {
+    std::string error;
+    const auto request = system_->stop_request(error);
+    if (request == StopRequest::FAILED)
+        return finish(StopPhase::PENDING, error);
+
+    StopStatus status;
+    error = system_->query(status);
+    if (!error.empty())
+        return finish(StopPhase::PENDING, error);
+
+    const auto now = system_->now();
+    if (terminated_by_ != StopPhase::PENDING)
+        return poll_terminated(status, now);
+
+    progress_ = stop_progress(progress_, status, now);
+    const auto phase = stop_decision(status, request, progress_, now, grace_period_);
+    switch (phase) {
+        case StopPhase::PENDING:
+            return false;
+        case StopPhase::STOPPED:
+            return finish(phase);
+        case StopPhase::CHANGED: {
+            std::ostringstream oss;
+            if (request == StopRequest::REFUSED)
+                oss << "Service " << name_ << " is " << status.state_name << " and cannot be stopped";
+            else
+                oss << "State of service " << name_ << " changed to " << status.state_name;
+            return finish(phase, oss.str());
+        }
+        default:
+            break;
+    }
+
+    if (status.shared_process) {
+        std::ostringstream oss;
+        oss << "Service " << name_ << " did not stop (" << stop_phase(phase)
+            << ") and shares its process with other services, so it cannot be terminated";
+        return finish(phase, oss.str());
+    }
+    if (!status.process_id) {
+        std::ostringstream oss;
+        oss << "Service " << name_ << " did not stop (" << stop_phase(phase) << ") and has no process to terminate";
+        return finish(phase, oss.str());
+    }
+
+    // Escalation may not find the process to terminate (it already exited, or the
+    // service reports a different one), so it is bounded like a termination
+    if (!escalating_) {
+        escalating_ = true;
+        escalated_at_ = now;
+    } else if (now - escalated_at_ > termination_timeout) {
+        std::ostringstream oss;
+        oss << "State of service " << name_ << " did not change to STOPPED within "
+            << (termination_timeout / 1000) << " seconds, and its process could not be terminated";
+        return finish(phase, oss.str());
+    }
+
+    auto process = system_->open(status.process_id, error);
+    if (!error.empty())
+        return finish(phase, error);
+    if (!process)
+        return false;
+
+    // The open process keeps its PID from being reused. Check that it still belongs to
+    // the service, which may have stopped between the two queries.
+    StopStatus current;
+    error = system_->query(current);
+    if (!error.empty())
+        return finish(phase, error);
+    if (current.state != status.state || current.process_id != status.process_id)
+        return false;
+
+    error = process->terminate_tree();
+    if (!error.empty())
+        return finish(phase, error);
+    terminated_by_ = phase;
+    terminated_at_ = now;
+    terminated_state_ = current.state;
+    return false;
+}
+
+bool StopJob::poll_terminated(const StopStatus& status, uint32_t now) {
+    if (status.state == STOP_STATE_STOPPED)
+        return finish(terminated_by_);
+    std::ostringstream oss;
+    // Until the SCM notices that the process is gone, the state stays what it was
+    if (status.state != terminated_state_ && status.state != STOP_STATE_STOP_PENDING) {
+        oss << "State of service " << name_ << " changed to " << status.state_name << " after terminating its process";
+        return finish(terminated_by_, oss.str());
+    }
+    if (now - terminated_at_ > termination_timeout) {
+        oss << "State of service " << name_ << " did not change to STOPPED within "
+            << (termination_timeout / 1000) << " seconds after terminating its process";
+        return finish(terminated_by_, oss.str());
+    }
+    return false;
+}
+
+bool StopJob::finish(StopPhase phase, const std::string& error) {
+    result_.error = error;
+    result_.phase = phase;
+    result_.elapsed = system_->now() - progress_.started;
+    return true;
+}
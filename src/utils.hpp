@@ -12,6 +12,14 @@ struct SC_HANDLE_closer {
 using SC_HANDLE_pointee = std::remove_reference<decltype(*SC_HANDLE{})>::type; 
 using SC_HANDLE_ptr     = std::unique_ptr<SC_HANDLE_pointee, SC_HANDLE_closer>;
 
+struct HANDLE_closer {
+    void operator()(HANDLE handle) {
+        if (handle && handle != INVALID_HANDLE_VALUE)
+            CloseHandle(handle);
+    }
+};
+using HANDLE_ptr = std::unique_ptr<void, HANDLE_closer>;
+
 extern std::wstring_convert<std::codecvt_utf8_utf16<wchar_t>> converter;
 
 std::wstring get_name(const Napi::Env& env, const Napi::Value& val);
@@ -0,0 +1,97 @@
+// Compares the one-shot enumeration used by enumerate() with the paged enumeration
+// used by enumerateStream() on a synthetic service set (see stub/windows.h).
+//
+// Usage: bench-enumerate oneshot|paged <services> [page size] [buffered pages]
+//
+// Each run measures a single mode, so that the peak resident set size of the process
+// belongs to that mode alone. Prints one line of JSON.
+#include "enum-services.hpp"
+#include "page-queue.hpp"
+#include <sys/resource.h>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <thread>
+
+namespace {
+    using clock = std::chrono::steady_clock;
+
+    long peak_rss_kib() {
+        rusage usage;
+        getrusage(RUSAGE_SELF, &usage);
+        return usage.ru_maxrss;
+    }
+
+    double ms_since(clock::time_point start, clock::time_point end) {
+        return std::chrono::duration<double, std::milli>(end - start).count();
+    }
+
+    // Stands in for handing an entry to JS
+    size_t consume(const ServiceEntry& entry) {
+        return entry.name.size() + entry.display_name.size() + entry.status.dwProcessId;
+    }
+}
+
+int main(int argc, char** argv) {
+    if (argc < 3) {
+        std::fprintf(stderr, "Usage: %s oneshot|paged <services> [page size] [buffered pages]\n", argv[0]);
+        return 2;
+    }
+    const std::string mode = argv[1];
+    stub_service_count() = std::strtoul(argv[2], nullptr, 10);
+    const DWORD page_size = argc > 3 ? std::strtoul(argv[3], nullptr, 10) : 64 * 1024;
+    const size_t max_pages = argc > 4 ? std::strtoul(argv[4], nullptr, 10) : 2;
+
+    const auto baseline = peak_rss_kib();
+    const auto start = clock::now();
+    clock::time_point first;
+    size_t count = 0, checksum = 0;
+
+    if (mode == "oneshot") {
+        // Like sc_enumerate: the whole result is built before the first entry is seen
+        std::vector<char> buffer;
+        DWORD n_services = 0;
+        if (!enum_services(nullptr, 0, 0, buffer, n_services))
+            return 1;
+        auto services = (LPENUM_SERVICE_STATUS_PROCESSW) buffer.data();
+        ServicePage result;
+        result.reserve(n_services);
+        for (DWORD i=0; i<n_services; ++i)
+            result.push_back({services[i].lpServiceName, services[i].lpDisplayName, services[i].ServiceStatusProcess});
+        first = clock::now();
+        for (const auto& entry : result) {
+            checksum += consume(entry);
+            ++count;
+        }
+    } else if (mode == "paged") {
+        // Like PageStream: a background thread fills a bounded queue of pages
+        PageQueue<ServicePage> queue(max_pages);
+        std::thread producer([&] {
+            enum_service_pages(nullptr, 0, 0, page_size, [&](ServicePage page) { return queue.push(std::move(page)); });
+            queue.finish(std::string());
+        });
+        ServicePage page;
+        std::string error;
+        while (queue.take(page, error) == PageQueue<ServicePage>::Take::PAGE) {
+            for (const auto& entry : page) {
+                if (count++ == 0)
+                    first = clock::now();
+                checksum += consume(entry);
+            }
+        }
+        producer.join();
+    } else {
+        std::fprintf(stderr, "Unknown mode %s\n", mode.c_str());
+        return 2;
+    }
+
+    const auto end = clock::now();
+    std::printf("{\"mode\":\"%s\",\"services\":%zu,\"firstMs\":", mode.c_str(), count);
+    if (count)
+        std::printf("%.3f", ms_since(start, first));
+    else
+        std::printf("null");
+    std::printf(",\"totalMs\":%.3f,\"baselineRssKiB\":%ld,\"peakRssKiB\":%ld,\"checksum\":%zu}\n",
+                ms_since(start, end), baseline, peak_rss_kib(), checksum);
+    return 0;
+}
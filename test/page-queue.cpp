@@ -0,0 +1,153 @@
+// Tests for the paged enumeration behind enumerateStream (src/enum-services.hpp and
+// src/page-queue.hpp) against the synthetic services of stub/windows.h.
+#include "enum-services.hpp"
+#include "page-queue.hpp"
+#include <unistd.h>
+#include <atomic>
+#include <cstdio>
+#include <thread>
+
+namespace {
+    int failures = 0;
+
+    #define CHECK(cond) do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while (0)
+
+    using Queue = PageQueue<ServicePage>;
+
+    // Runs enum_service_pages into queue on a thread, like PageStream::start
+    struct Producer {
+        Queue&             queue;
+        std::atomic<int>   pushed{0};
+        std::atomic<bool>  finished{false};
+        std::thread        thread;
+
+        Producer(Queue& queue, DWORD page_size) : queue(queue) {
+            thread = std::thread([this, page_size] {
+                const auto ok = enum_service_pages(nullptr, 0, 0, page_size, [this](ServicePage page) {
+                    if (!this->queue.push(std::move(page)))
+                        return false;
+                    ++pushed;
+                    return true;
+                });
+                this->queue.finish(ok ? std::string() : std::string("failed"));
+                finished = true;
+            });
+        }
+
+        ~Producer() {
+            queue.close();
+            thread.join();
+        }
+    };
+
+    // Waits up to one second for cond
+    template<typename Cond>
+    bool eventually(Cond cond) {
+        for (int i=0; i<1000 && !cond(); ++i)
+            usleep(1000);
+        return cond();
+    }
+
+    void check_all_services_once(DWORD services, DWORD page_size) {
+        stub_service_count() = services;
+        Queue queue(2);
+        Producer producer(queue, page_size);
+        ServicePage page;
+        std::string error;
+        DWORD next = 0, pages = 0;
+        bool in_order = true;
+        while (queue.take(page, error) == Queue::Take::PAGE) {
+            ++pages;
+            for (const auto& entry : page) {
+                in_order = in_order && entry.name == stub_service_name(next) &&
+                           entry.display_name == stub_display_name(next);
+                ++next;
+            }
+        }
+        CHECK(error.empty());
+        CHECK(in_order);
+        CHECK(next == services);
+        if (services > 1)
+            CHECK(pages > 1);
+    }
+
+    void test_all_services_once() {
+        check_all_services_once(0, 4096);
+        check_all_services_once(1, 4096);
+        check_all_services_once(1000, 4096);
+        // Everything fits into a single page
+        check_all_services_once(1000, 256 * 1024 - 1);
+        // The page is smaller than a single entry, so it has to grow
+        check_all_services_once(100, 16);
+    }
+
+    void test_back_pressure() {
+        stub_service_count() = 10000;
+        stub_enum_calls() = 0;
+        Queue queue(3);
+        Producer producer(queue, 1024);
+        CHECK(eventually([&] { return queue.size() == 3; }));
+        usleep(50000);
+        // The producer fetched one more page and is blocked pushing it
+        CHECK(producer.pushed == 3);
+        CHECK(stub_enum_calls() == 4);
+        CHECK(!producer.finished);
+
+        ServicePage page;
+        std::string error;
+        CHECK(queue.try_take(page, error) == Queue::Take::PAGE);
+        CHECK(eventually([&] { return producer.pushed == 4; }));
+        usleep(50000);
+        CHECK(producer.pushed == 4);
+        CHECK(queue.size() == 3);
+    }
+
+    void test_close_stops_producer() {
+        stub_service_count() = 10000;
+        stub_enum_calls() = 0;
+        Queue queue(2);
+        Producer producer(queue, 1024);
+        CHECK(eventually([&] { return queue.size() == 2; }));
+        queue.close();
+        CHECK(eventually([&] { return producer.finished.load(); }));
+        CHECK(producer.pushed == 2);
+        CHECK(stub_enum_calls() == 3);
+
+        ServicePage page;
+        std::string error;
+        CHECK(queue.try_take(page, error) == Queue::Take::END);
+        CHECK(error.empty());
+    }
+
+    void test_empty_until_first_page() {
+        Queue queue(1);
+        ServicePage page;
+        std::string error;
+        CHECK(queue.try_take(page, error) == Queue::Take::EMPTY);
+        CHECK(queue.push(ServicePage(1)));
+        CHECK(queue.try_take(page, error) == Queue::Take::PAGE);
+        CHECK(page.size() == 1);
+        queue.finish("failed");
+        CHECK(queue.try_take(page, error) == Queue::Take::END);
+        CHECK(error == "failed");
+    }
+}
+
+int main() {
+    test_all_services_once();
+    test_back_pressure();
+    test_close_stops_producer();
+    test_empty_until_first_page();
+
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("page-queue: all tests passed\n");
+    return 0;
+}
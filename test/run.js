@@ -0,0 +1,52 @@
+// Builds the platform independent native code against the stubs in test/stub with the
+// host compiler ($CXX, default c++) and runs it. The tests need Linux, the benchmark
+// also runs on macOS.
+//
+// Usage: node test/run.js test
+//        node test/run.js bench [services]
+const child_process = require('child_process');
+const os = require('os');
+const path = require('path');
+
+const src = path.join(__dirname, '..', 'src');
+const stub = path.join(__dirname, 'stub');
+
+function build(name) {
+    const output = path.join(os.tmpdir(), `win32-service-${name}`);
+    child_process.execFileSync(process.env.CXX || 'c++', [
+        '-std=c++14', '-O2', '-Wall', '-pthread', '-I', stub, '-I', src,
+        path.join(__dirname, `${name}.cpp`), '-o', output,
+    ], {stdio: 'inherit'});
+    return output;
+}
+
+function bench(services) {
+    const program = build('bench-enumerate');
+    for (const mode of ['oneshot', 'paged']) {
+        // Separate processes, so that each mode gets its own peak memory
+        const output = child_process.execFileSync(program, [mode, String(services)], {encoding: 'utf8'});
+        console.log(JSON.parse(output));
+    }
+}
+
+function test() {
+    for (const name of ['page-queue', 'stop-policy']) {
+        const result = child_process.spawnSync(build(name), [], {stdio: 'inherit'});
+        if (result.status !== 0) {
+            process.exit(result.status || 1);
+        }
+    }
+}
+
+const [command = 'test', ...args] = process.argv.slice(2);
+switch (command) {
+case 'test':
+    test();
+    break;
+case 'bench':
+    bench(args.length ? Number(args[0]) : 200000);
+    break;
+default:
+    console.error(`Unknown command ${command}`);
+    process.exit(2);
+}
@@ -0,0 +1,442 @@
+// Tests for stopWithin's escalation policy (src/stop-policy.hpp) against a simulated
+// service control manager. The service "processes" are real dummy process trees,
+// which are terminated through their process group. Linux only.
+#include "stop-policy.hpp"
+#include <sys/prctl.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <csignal>
+#include <cstdio>
+#include <functional>
+
+namespace {
+    int failures = 0;
+
+    #define CHECK(cond) do { \
+        if (!(cond)) { \
+            std::fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+            ++failures; \
+        } \
+    } while (0)
+
+    const uint32_t STOP_STATE_START_PENDING = 2;
+
+    // A dummy service process with one child, in its own process group
+    struct DummyTree {
+        pid_t root = 0;
+        pid_t child = 0;
+        bool  root_reaped = false;
+
+        DummyTree() {
+            int fds[2];
+            if (pipe(fds) != 0)
+                return;
+            root = fork();
+            if (root == 0) {
+                setpgid(0, 0);
+                const pid_t child = fork();
+                if (child == 0) {
+                    execlp("sleep", "sleep", "60", nullptr);
+                    _exit(127);
+                }
+                if (write(fds[1], &child, sizeof(child)) != sizeof(child))
+                    _exit(127);
+                execlp("sleep", "sleep", "60", nullptr);
+                _exit(127);
+            }
+            setpgid(root, root);
+            close(fds[1]);
+            if (read(fds[0], &child, sizeof(child)) != sizeof(child))
+                child = 0;
+            close(fds[0]);
+        }
+
+        ~DummyTree() {
+            if (root > 0)
+                kill(-root, SIGKILL);
+            if (!root_reaped)
+                waitpid(root, nullptr, 0);
+            // The test process is a subreaper, so the orphaned child is ours to reap
+            if (child > 0)
+                waitpid(child, nullptr, 0);
+        }
+
+        bool root_alive() {
+            int status;
+            if (!root_reaped && waitpid(root, &status, WNOHANG) == root)
+                root_reaped = true;
+            return !root_reaped;
+        }
+
+        bool child_killed() {
+            for (int i=0; i<1000; ++i) {
+                int status;
+                if (waitpid(child, &status, WNOHANG) == child) {
+                    child = 0;
+                    return WIFSIGNALED(status) && WTERMSIG(status) == SIGKILL;
+                }
+                usleep(1000);
+            }
+            return false;
+        }
+    };
+
+    // Simulated service control manager state for one service
+    struct FakeService {
+        uint32_t    clock = 0;
+        uint32_t    state = STOP_STATE_STOP_PENDING;
+        const char* state_name = "STOP_PENDING";
+        uint32_t    check_point = 0;
+        uint32_t    wait_hint = 0;
+        bool        shared_process = false;
+        bool        ignore_terminate = false;
+        bool        process_gone = false;
+        uint32_t    pid_offset = 0;
+        DummyTree*  process = nullptr;
+        StopRequest request = StopRequest::ACCEPTED;
+        int         stops_sent = 0;
+        int         terminations = 0;
+        std::function<void(FakeService&)> after_open;
+    };
+
+    class FakeProcess : public StopProcess {
+        public:
+            FakeProcess(FakeService& service, pid_t pid) : service_(service), pid_(pid) {}
+
+            std::string terminate_tree() override {
+                ++service_.terminations;
+                if (!service_.ignore_terminate && kill(-pid_, SIGKILL) != 0)
+                    return "kill failed";
+                return std::string();
+            }
+
+        private:
+            FakeService& service_;
+            pid_t        pid_;
+    };
+
+    class FakeSystem : public StopSystem {
+        public:
+            FakeSystem(FakeService& service) : service_(service) {}
+
+            uint32_t now() override {
+                return service_.clock;
+            }
+
+            void send_stop() override {
+                ++service_.stops_sent;
+            }
+
+            StopRequest stop_request(std::string& error) override {
+                if (service_.request == StopRequest::FAILED)
+                    error = "ControlService: Access is denied. (5)";
+                return service_.request;
+            }
+
+            std::string query(StopStatus& status) override {
+                // Like the SCM, notice when the service process has exited
+                if (service_.process && !service_.process->root_alive()) {
+                    service_.process = nullptr;
+                    service_.state = STOP_STATE_STOPPED;
+                    service_.state_name = "STOPPED";
+                }
+                status.state          = service_.state;
+                status.state_name     = service_.state_name;
+                status.check_point    = service_.check_point;
+                status.wait_hint      = service_.wait_hint;
+                status.process_id     = service_.process ? service_.process->root + service_.pid_offset : 0;
+                status.shared_process = service_.shared_process;
+                return std::string();
+            }
+
+            std::unique_ptr<StopProcess> open(uint32_t pid, std::string&) override {
+                if (service_.process_gone)
+                    return nullptr;
+                std::unique_ptr<StopProcess> process(new FakeProcess(service_, pid));
+                if (service_.after_open)
+                    service_.after_open(service_);
+                return process;
+            }
+
+        private:
+            FakeService& service_;
+    };
+
+    // Polls like the stop monitor thread, advancing the simulated clock by step ms
+    StopResult run(FakeService& service, uint32_t grace_period, uint32_t step = 100,
+                   std::function<void(FakeService&)> tick = nullptr) {
+        StopJob job("Dummy", grace_period, std::unique_ptr<StopSystem>(new FakeSystem(service)));
+        for (int i=0; i<100000; ++i) {
+            if (job.poll())
+                return job.result();
+            service.clock += step;
+            if (tick)
+                tick(service);
+            usleep(1000);
+        }
+        return {"did not finish", StopPhase::PENDING, 0};
+    }
+
+    StopStatus status(uint32_t state, uint32_t check_point = 0, uint32_t wait_hint = 0) {
+        return {state, "", check_point, wait_hint, 0, false};
+    }
+
+    void test_decision() {
+        const StopProgress progress{1000, 1000, 0};
+        CHECK(stop_decision(status(STOP_STATE_STOPPED), StopRequest::ACCEPTED, progress, 1000, 0) == StopPhase::STOPPED);
+        CHECK(stop_decision(status(STOP_STATE_RUNNING), StopRequest::ACCEPTED, progress, 1000, 5000) == StopPhase::CHANGED);
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::ACCEPTED, progress, 1000, 5000) == StopPhase::PENDING);
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::ACCEPTED, progress, 6000, 5000) == StopPhase::TIMEOUT);
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::ACCEPTED, progress, 1000, 0) == StopPhase::TIMEOUT);
+        // Without a wait hint only the grace period counts
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::ACCEPTED, progress, 5999, 5000) == StopPhase::PENDING);
+        // With a wait hint, a checkpoint that does not advance is a stall
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING, 0, 500), StopRequest::ACCEPTED, progress, 1500, 5000) == StopPhase::PENDING);
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING, 0, 500), StopRequest::ACCEPTED, progress, 1501, 5000) == StopPhase::STALLED);
+        // Advancing checkpoints restart the wait hint
+        const auto advanced = stop_progress(progress, status(STOP_STATE_STOP_PENDING, 1, 500), 1400);
+        CHECK(advanced.started == 1000 && advanced.last_progress == 1400 && advanced.last_check_point == 1);
+        CHECK(stop_progress(advanced, status(STOP_STATE_STOP_PENDING, 1, 500), 1800).last_progress == 1400);
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING, 1, 500), StopRequest::ACCEPTED, advanced, 1800, 5000) == StopPhase::PENDING);
+        // While the stop control is unanswered, a RUNNING service may have a hung control
+        // handler and is subject to the grace period, other states wait for the answer
+        CHECK(stop_decision(status(STOP_STATE_RUNNING), StopRequest::PENDING, progress, 1000, 5000) == StopPhase::PENDING);
+        CHECK(stop_decision(status(STOP_STATE_RUNNING), StopRequest::PENDING, progress, 6000, 5000) == StopPhase::TIMEOUT);
+        CHECK(stop_decision(status(STOP_STATE_RUNNING), StopRequest::TIMED_OUT, progress, 6000, 5000) == StopPhase::TIMEOUT);
+        CHECK(stop_decision(status(STOP_STATE_START_PENDING), StopRequest::PENDING, progress, 6000, 5000) == StopPhase::PENDING);
+        CHECK(stop_decision(status(STOP_STATE_START_PENDING), StopRequest::REFUSED, progress, 1000, 5000) == StopPhase::CHANGED);
+        // A refused control is fine if the service is already stopping
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::REFUSED, progress, 1000, 5000) == StopPhase::PENDING);
+        // Times wrap like GetTickCount
+        const StopProgress wrapping{0xffffff00, 0xffffff00, 0};
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::ACCEPTED, wrapping, 0x100, 1000) == StopPhase::PENDING);
+        CHECK(stop_decision(status(STOP_STATE_STOP_PENDING), StopRequest::ACCEPTED, wrapping, 0x300, 1000) == StopPhase::TIMEOUT);
+    }
+
+    void test_stops_by_itself() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        auto result = run(service, 5000, 100, [](FakeService& s) {
+            if (s.clock == 800) {
+                s.state = STOP_STATE_STOPPED;
+                s.state_name = "STOPPED";
+            }
+        });
+        CHECK(result.error.empty());
+        CHECK(result.phase == StopPhase::STOPPED);
+        CHECK(result.elapsed == 800);
+        CHECK(service.terminations == 0);
+        CHECK(tree.root_alive());
+    }
+
+    void test_stall_terminates_tree() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.wait_hint = 1000;
+        auto result = run(service, 60000);
+        CHECK(result.error.empty());
+        CHECK(result.phase == StopPhase::STALLED);
+        CHECK(result.elapsed > 1000 && result.elapsed < 60000);
+        CHECK(service.terminations == 1);
+        CHECK(!tree.root_alive());
+        CHECK(tree.child_killed());
+    }
+
+    void test_progress_until_timeout() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.wait_hint = 500;
+        auto result = run(service, 3000, 100, [](FakeService& s) { ++s.check_point; });
+        CHECK(result.error.empty());
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.elapsed >= 3000);
+        CHECK(service.terminations == 1);
+        CHECK(tree.child_killed());
+    }
+
+    void test_no_wait_hint_gets_grace_period() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        auto result = run(service, 3000);
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.elapsed >= 3000);
+        CHECK(tree.child_killed());
+    }
+
+    void test_rejected_stop() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.wait_hint = 1000;
+        auto result = run(service, 5000, 100, [](FakeService& s) {
+            if (s.clock == 300) {
+                s.state = STOP_STATE_RUNNING;
+                s.state_name = "RUNNING";
+            }
+        });
+        CHECK(result.phase == StopPhase::CHANGED);
+        CHECK(result.error == "State of service Dummy changed to RUNNING");
+        CHECK(service.terminations == 0);
+        CHECK(tree.root_alive());
+    }
+
+    void test_pid_changes_before_terminate() {
+        // The service stops by itself between the status query and opening its process
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.after_open = [](FakeService& s) {
+            s.process = nullptr;
+            s.state = STOP_STATE_STOPPED;
+            s.state_name = "STOPPED";
+        };
+        auto result = run(service, 1000);
+        CHECK(result.error.empty());
+        CHECK(result.phase == StopPhase::STOPPED);
+        CHECK(service.terminations == 0);
+        CHECK(tree.root_alive());
+    }
+
+    void test_shared_process() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.shared_process = true;
+        auto result = run(service, 1000);
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(!result.error.empty());
+        CHECK(service.terminations == 0);
+        CHECK(tree.root_alive());
+    }
+
+    void test_stop_request_times_out() {
+        // The control handler hangs: the service stays RUNNING, and ControlService only
+        // fails with ERROR_SERVICE_REQUEST_TIMEOUT after the grace period
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.state = STOP_STATE_RUNNING;
+        service.state_name = "RUNNING";
+        service.request = StopRequest::PENDING;
+        auto result = run(service, 2000, 100, [](FakeService& s) {
+            if (s.clock == 30000)
+                s.request = StopRequest::TIMED_OUT;
+        });
+        CHECK(service.stops_sent == 1);
+        CHECK(result.error.empty());
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.elapsed >= 2000 && result.elapsed < 30000);
+        CHECK(service.terminations == 1);
+        CHECK(tree.child_killed());
+    }
+
+    void test_stop_request_timed_out_before_grace_period() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.state = STOP_STATE_RUNNING;
+        service.state_name = "RUNNING";
+        service.request = StopRequest::PENDING;
+        auto result = run(service, 40000, 100, [](FakeService& s) {
+            if (s.clock == 30000)
+                s.request = StopRequest::TIMED_OUT;
+        });
+        CHECK(result.error.empty());
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.elapsed >= 40000);
+        CHECK(tree.child_killed());
+    }
+
+    void test_stop_request_refused() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.state = STOP_STATE_START_PENDING;
+        service.state_name = "START_PENDING";
+        service.wait_hint = 500;
+        service.request = StopRequest::REFUSED;
+        auto result = run(service, 5000);
+        CHECK(result.phase == StopPhase::CHANGED);
+        CHECK(result.error == "Service Dummy is START_PENDING and cannot be stopped");
+        CHECK(service.terminations == 0);
+        CHECK(tree.root_alive());
+    }
+
+    void test_stop_request_failed() {
+        FakeService service;
+        service.request = StopRequest::FAILED;
+        auto result = run(service, 5000);
+        CHECK(result.error == "ControlService: Access is denied. (5)");
+        CHECK(service.terminations == 0);
+    }
+
+    void test_process_gone_while_stop_pending() {
+        // The SCM keeps reporting STOP_PENDING with a PID that no longer exists
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.process_gone = true;
+        auto result = run(service, 1000);
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.error.find("its process could not be terminated") != std::string::npos);
+        CHECK(result.elapsed > 1000 + StopJob::termination_timeout);
+        CHECK(result.elapsed < 1000 + StopJob::termination_timeout + 1000);
+        CHECK(service.terminations == 0);
+    }
+
+    void test_pid_keeps_changing() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.after_open = [](FakeService& s) { ++s.pid_offset; };
+        auto result = run(service, 1000);
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.error.find("its process could not be terminated") != std::string::npos);
+        CHECK(result.elapsed < 1000 + StopJob::termination_timeout + 1000);
+        CHECK(service.terminations == 0);
+    }
+
+    void test_termination_timeout() {
+        DummyTree tree;
+        FakeService service;
+        service.process = &tree;
+        service.ignore_terminate = true;
+        auto result = run(service, 1000);
+        CHECK(result.phase == StopPhase::TIMEOUT);
+        CHECK(result.error.find("did not change to STOPPED within 10 seconds") != std::string::npos);
+        CHECK(result.elapsed > 1000 + StopJob::termination_timeout);
+        CHECK(service.terminations == 1);
+    }
+}
+
+int main() {
+    // Orphaned children of the dummy services are reparented to this process
+    prctl(PR_SET_CHILD_SUBREAPER, 1);
+
+    test_decision();
+    test_stops_by_itself();
+    test_stall_terminates_tree();
+    test_progress_until_timeout();
+    test_no_wait_hint_gets_grace_period();
+    test_rejected_stop();
+    test_pid_changes_before_terminate();
+    test_shared_process();
+    test_stop_request_times_out();
+    test_stop_request_timed_out_before_grace_period();
+    test_stop_request_refused();
+    test_stop_request_failed();
+    test_process_gone_while_stop_pending();
+    test_pid_keeps_changing();
+    test_termination_timeout();
+
+    if (failures) {
+        std::fprintf(stderr, "%d check(s) failed\n", failures);
+        return 1;
+    }
+    std::printf("stop-policy: all tests passed\n");
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Minimal stand-in for <windows.h> so that the platform independent parts of the
+// addon can be built and exercised on other platforms. EnumServicesStatusExW
+// returns stub_service_count() synthetic services, paged like the real one.
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <cwchar>
+#include <string>
+
+typedef uint32_t       DWORD;
+typedef int            BOOL;
+typedef unsigned char* LPBYTE;
+typedef wchar_t*       LPWSTR;
+typedef const wchar_t* LPCWSTR;
+typedef struct SC_HANDLE__* SC_HANDLE;
+
+#define TRUE  1
+#define FALSE 0
+
+#define SC_ENUM_PROCESS_INFO      0
+#define ERROR_INVALID_HANDLE      6
+#define ERROR_MORE_DATA           234
+#define SERVICE_WIN32_OWN_PROCESS 0x10
+#define SERVICE_RUNNING           0x4
+
+struct SERVICE_STATUS_PROCESS {
+    DWORD dwServiceType;
+    DWORD dwCurrentState;
+    DWORD dwControlsAccepted;
+    DWORD dwWin32ExitCode;
+    DWORD dwServiceSpecificExitCode;
+    DWORD dwCheckPoint;
+    DWORD dwWaitHint;
+    DWORD dwProcessId;
+    DWORD dwServiceFlags;
+};
+
+struct ENUM_SERVICE_STATUS_PROCESSW {
+    LPWSTR                 lpServiceName;
+    LPWSTR                 lpDisplayName;
+    SERVICE_STATUS_PROCESS ServiceStatusProcess;
+};
+typedef ENUM_SERVICE_STATUS_PROCESSW* LPENUM_SERVICE_STATUS_PROCESSW;
+
+inline DWORD& stub_last_error() {
+    static thread_local DWORD error = 0;
+    return error;
+}
+
+inline DWORD GetLastError() { return stub_last_error(); }
+inline void SetLastError(DWORD error) { stub_last_error() = error; }
+
+inline DWORD& stub_service_count() {
+    static DWORD count = 0;
+    return count;
+}
+
+inline DWORD& stub_enum_calls() {
+    static DWORD calls = 0;
+    return calls;
+}
+
+inline std::wstring stub_service_name(DWORD i) {
+    return L"StubService" + std::to_wstring(i);
+}
+
+inline std::wstring stub_display_name(DWORD i) {
+    return L"Synthetic service number " + std::to_wstring(i) + L" for enumeration benchmarks";
+}
+
+inline DWORD stub_digits(DWORD i) {
+    DWORD digits = 1;
+    for (; i >= 10; i /= 10)
+        ++digits;
+    return digits;
+}
+
+// Both strings contain the number of the entry. The single digit in the strings of
+// entry 0 stands in for the terminating nulls.
+inline DWORD stub_entry_size(DWORD i) {
+    return sizeof(ENUM_SERVICE_STATUS_PROCESSW) +
+           (stub_service_name(0).size() + stub_display_name(0).size() + 2 * stub_digits(i)) * sizeof(wchar_t);
+}
+
+// Total size of entries first..count-1, computed per number of digits
+inline DWORD stub_range_size(DWORD first, DWORD count) {
+    DWORD size = 0;
+    for (DWORD begin = first, end; begin < count; begin = end) {
+        DWORD limit = 10;
+        while (limit <= begin)
+            limit *= 10;
+        end = std::min(count, limit);
+        size += (end - begin) * stub_entry_size(begin);
+    }
+    return size;
+}
+
+// Entries are packed from the start of the buffer, their strings from the end
+inline BOOL EnumServicesStatusExW(SC_HANDLE, int, DWORD, DWORD, LPBYTE buffer, DWORD buffer_size,
+                                  DWORD* bytes_needed, DWORD* services_returned, DWORD* resume_handle,
+                                  LPCWSTR) {
+    ++stub_enum_calls();
+    const DWORD first = resume_handle ? *resume_handle : 0;
+    const DWORD count = stub_service_count();
+    auto entries = reinterpret_cast<LPENUM_SERVICE_STATUS_PROCESSW>(buffer);
+    // Like the real one, keep the strings aligned even if buffer_size is not
+    buffer_size -= buffer_size % sizeof(wchar_t);
+    auto strings = buffer + buffer_size;
+    DWORD used = 0, i = first;
+    for (; i < count && used + stub_entry_size(i) <= buffer_size; ++i) {
+        auto copy = [&strings](const std::wstring& s) {
+            strings -= (s.size() + 1) * sizeof(wchar_t);
+            std::memcpy(strings, s.c_str(), (s.size() + 1) * sizeof(wchar_t));
+            return reinterpret_cast<LPWSTR>(strings);
+        };
+        auto& entry = entries[i - first];
+        entry.lpServiceName = copy(stub_service_name(i));
+        entry.lpDisplayName = copy(stub_display_name(i));
+        entry.ServiceStatusProcess = SERVICE_STATUS_PROCESS{SERVICE_WIN32_OWN_PROCESS, SERVICE_RUNNING, 0, 0, 0, 0, 0, 1000 + i, 0};
+        used += stub_entry_size(i);
+    }
+    *services_returned = i - first;
+    *bytes_needed = stub_range_size(i, count);
+    if (i < count) {
+        if (resume_handle)
+            *resume_handle = i;
+        SetLastError(ERROR_MORE_DATA);
+        return FALSE;
+    }
+    if (resume_handle)
+        *resume_handle = 0;
+    return TRUE;
+}